@@ -0,0 +1,398 @@
+#ifndef __ISS_ALIGN_HH__
+#define __ISS_ALIGN_HH__
+
+#include <Rtypes.h> // For root types
+#include <cmath>
+#include <cstdio>
+
+#include "ISSWord.hh" // For module IDs and the word decoding
+#include "ISSHit.hh"  // For ISS_NOTIME
+
+#define ISS_ALIGN_NPULSES 64 // Number of EBIS pulses kept for hit assignment
+#define ISS_ALIGN_MAXMOD 64  // Number of module numbers (6 bits in the info word)
+
+// Streaming alignment of one ADC clock to the V1495 global clock.
+//
+// Every EBIS pulse gives a pair (ADC ticks, global ns), where the ADC ticks
+// are taken between the extended ADC timestamps just before and just after
+// the pulse in the data stream (see ISSAlign). The residual
+// r = (global ns - nominal ADC ns) is fitted on the fly as r = offset + drift*u
+// with exponentially decaying weights, so each update and each conversion is
+// O(1) and the fit follows slow changes of the clock drift.
+class ISSClock {
+
+ private:
+   Double_t tick;       // Nominal length of one ADC tick in ns
+   Double_t lambda;     // Forgetting factor of the fit (0 < lambda <= 1)
+   Double_t window;     // Maximum accepted residual of a new pair in ns
+   UInt_t maxreject;    // Consecutive rejected pairs before the fit restarts
+
+   ULong64_t x0;        // Reference point of the fit in ADC ticks
+   Double_t y0;         // Reference point of the fit in global ns
+   Double_t w;          // Sum of weights
+   Double_t mu, mr;     // Weighted means of u and r
+   Double_t cuu, cur;   // Weighted (co)variances of u and r
+   Double_t offset;     // Fitted offset in ns at u = mu
+   Double_t drift;      // Fitted drift (dimensionless, ADC vs global)
+
+   ULong64_t last_x;    // Latest ADC ticks used in a pair
+   ULong64_t last_in;   // Last ADC ticks converted
+   ULong64_t last_out;  // Last converted time in ns
+   UInt_t npairs;       // Accepted pairs since the last restart
+   UInt_t nreject;      // Consecutive rejected pairs
+   UInt_t nrestart;     // Number of restarts of the fit
+
+   //..........................................................................
+   // Restart the fit at the given pair
+   void Seed(ULong64_t _x, Double_t _y) {
+       x0 = _x;
+       y0 = _y;
+       w = 1;
+       mu = mr = 0;
+       cuu = cur = 0;
+       offset = 0;
+       drift = 0;
+       last_x = _x;
+       last_in = 0;
+       last_out = 0;
+       npairs = 1;
+       nreject = 0;
+   };
+
+ public:
+
+   //..........................................................................
+   // Constructor
+   ISSClock(Double_t _tick = 8, Double_t _window = 100000, Double_t _lambda = 0.99,
+            UInt_t _maxreject = 8) {
+       tick = _tick;
+       window = _window;
+       lambda = _lambda;
+       maxreject = _maxreject;
+       nrestart = 0;
+       Reset();
+   };
+
+   //..........................................................................
+   // Forget the fit
+   void Reset() {
+       Seed(0, 0);
+       npairs = 0;
+   };
+
+   //..........................................................................
+   // Forget the fit because the ADC clock was reset
+   void Restart() {
+       if (npairs) nrestart++;
+       Reset();
+   };
+
+   //..........................................................................
+   // Add a pair of ADC ticks and global time (ns). Returns kFALSE if the
+   // pair was rejected as an outlier
+   Bool_t AddPair(ULong64_t _x, Double_t _y) {
+
+       // First pair or the ADC clock was reset (e.g. DAQ restart between runs).
+       // The pairs of modules sharing the clock may be slightly out of order,
+       // so only a step back by more than the window is a reset.
+       if (!npairs || (_x < last_x && (Double_t)(last_x - _x) * tick > window)) {
+           if (npairs) nrestart++;
+           Seed(_x, _y);
+           return(kTRUE);
+       }
+
+       Double_t u = ((Double_t)_x - (Double_t)x0) * tick;
+       Double_t r = (_y - y0) - u;
+
+       // Reject pairs too far from the current fit, unless too many in a row
+       // were rejected, which means that the clock has jumped
+       if (fabs(r - (offset + drift * (u - mu))) > window) {
+           if (++nreject <= maxreject) return(kFALSE);
+           nrestart++;
+           Seed(_x, _y);
+           return(kTRUE);
+       }
+       nreject = 0;
+       if (_x > last_x) last_x = _x;
+       npairs++;
+
+       // Exponentially weighted incremental update of means and covariances
+       cuu *= lambda;
+       cur *= lambda;
+       w = lambda * w + 1;
+       Double_t du = u - mu;
+       Double_t dr = r - mr;
+       mu += du / w;
+       mr += dr / w;
+       cuu += du * (u - mu);
+       cur += du * (r - mr);
+
+       // Keep the drift at zero until the pairs span a measurable interval
+       drift = (cuu > 0) ? cur / cuu : 0;
+       offset = mr;
+       return(kTRUE);
+   };
+
+   //..........................................................................
+   // Convert ADC ticks to global time in ns. The result never goes backwards
+   // for non-decreasing ticks, even when the fit is updated in between.
+   // Returns ISS_NOTIME until the clock has been paired with an EBIS pulse,
+   // as the ADC and V1495 clocks have unrelated origins.
+   ULong64_t GetTime(ULong64_t _x) {
+       if (!npairs) return(ISS_NOTIME);
+       Double_t u = ((Double_t)_x - (Double_t)x0) * tick;
+       Double_t t = y0 + u + offset + drift * (u - mu);
+       ULong64_t result = (t > 0) ? (ULong64_t)(t + 0.5) : 0;
+       if (_x >= last_in && result < last_out) result = last_out;
+       last_in = _x;
+       last_out = result;
+       return(result);
+   };
+
+   //..........................................................................
+   // Getters (the offset is global minus nominal ADC time at the fit centre)
+   inline Double_t GetTick()     { return(tick); };
+   inline Double_t GetDrift()    { return(drift); };
+   inline Double_t GetOffset()   { return(y0 + offset - (Double_t)x0 * tick); };
+   inline UInt_t   GetNPairs()   { return(npairs); };
+   inline Bool_t   IsAligned()   { return(npairs > 0); };
+   inline UInt_t   GetNRestart() { return(nrestart); };
+
+   //..........................................................................
+   // Setters
+   void SetTick(Double_t _tick)     { tick = _tick; };
+   void SetWindow(Double_t _window) { window = _window; };
+   void SetLambda(Double_t _lambda) { lambda = _lambda; };
+
+   //..........................................................................
+   // Show some information for debugging
+   void Show(UInt_t level = 1) {
+       if (level < 1) return;
+       printf("Tick %.3f ns pairs %u restarts %u offset %.1f ns drift %.3e\n",
+              tick, npairs, nrestart, GetOffset(), drift);
+   };
+};
+
+// Puts the V1725 and V1730 ADC timestamps on the V1495 timeline (in ns) and
+// assigns each hit to the latest EBIS pulse before it. Feed every word to
+// AddWord() in stream order, then use GetTime() and GetPulse() for the hits.
+//
+// All modules other than the V1730 share one clock. The timestamps of one
+// module only go backwards when the clocks are reset (e.g. DAQ restart between
+// runs). The first module to do so restarts the fit of its clock, and the
+// others sharing it are not aligned until they have been reset too.
+class ISSAlign {
+
+ public:
+   // enumeration for the clocks
+   enum clock_id_t {
+       CLOCK_V1725 = 0, // All ADC modules other than the V1730
+       CLOCK_V1730 = 1,
+       NCLOCKS     = 2
+   };
+
+ private:
+   ISSClock clocks[NCLOCKS];
+   ULong64_t last_ticks[ISS_ALIGN_MAXMOD]; // Latest full ADC timestamp of each module
+   Bool_t seen[ISS_ALIGN_MAXMOD];  // Module has had a timestamp
+   UInt_t mod_epoch[ISS_ALIGN_MAXMOD]; // Clock restarts the module has caught up with
+   UInt_t epoch[NCLOCKS];          // Restarts of each clock after a reset
+   ULong64_t clock_ticks[NCLOCKS]; // Latest ADC timestamp of each clock (current modules)
+   Bool_t clock_seen[NCLOCKS];     // Clock has had a timestamp
+   Double_t pending[NCLOCKS];      // EBIS pulse waiting for the next ADC timestamp (ns, <0 if none)
+   ULong64_t before[NCLOCKS];      // ADC timestamp just before that pulse
+   Double_t global_tick;           // V1495 tick length in ns
+   UInt_t id_v1495, id_v1730;      // Module numbers of the V1495 and the V1730
+   Double_t max_interval;          // Widest ADC timestamp interval used for a pair (ns)
+   ULong64_t pulse[ISS_ALIGN_NPULSES]; // Ring of recent EBIS pulse times (ns)
+   Long64_t npulses;               // Total number of EBIS pulses seen
+   ULong64_t naligned;             // Times a clock or module became aligned
+
+ public:
+
+   //..........................................................................
+   // Constructor
+   ISSAlign(Double_t _global_tick = 10, Double_t _tick_v1725 = 8,
+            Double_t _tick_v1730 = 16, Double_t _max_interval = 100000) {
+       global_tick = _global_tick;
+       max_interval = _max_interval;
+       id_v1495 = CAEN_V1495_MOD_ID;
+       id_v1730 = CAEN_V1730_MOD_ID;
+       clocks[CLOCK_V1725].SetTick(_tick_v1725);
+       clocks[CLOCK_V1730].SetTick(_tick_v1730);
+       Reset();
+   };
+
+   //..........................................................................
+   // Forget all pulses and fits
+   void Reset() {
+       for (UInt_t i = 0; i < NCLOCKS; i++) {
+           clocks[i].Reset();
+           epoch[i] = 0;
+           clock_ticks[i] = 0;
+           clock_seen[i] = kFALSE;
+           before[i] = 0;
+           pending[i] = -1;
+       }
+       for (UInt_t i = 0; i < ISS_ALIGN_MAXMOD; i++) {
+           last_ticks[i] = 0;
+           seen[i] = kFALSE;
+           mod_epoch[i] = 0;
+       }
+       npulses = 0;
+       naligned = 0;
+   };
+
+   //..........................................................................
+   // Set the module numbers of the V1495 and the V1730, if they are not the
+   // default ones (see also ISSWord::SetModuleIDs)
+   void SetModuleIDs(UInt_t _id_v1495, UInt_t _id_v1730) {
+       id_v1495 = _id_v1495;
+       id_v1730 = _id_v1730;
+   };
+
+   //..........................................................................
+   // Get the clock of a module
+   inline UInt_t GetClockID(UInt_t module) {
+       return((id_v1730 == module) ? CLOCK_V1730 : CLOCK_V1725);
+   };
+
+   //..........................................................................
+   // Treat a word: update the ADC clocks and record EBIS pulses.
+   //
+   // The words are merged roughly in time order, so the ADC time of an EBIS
+   // pulse lies between the ADC timestamps just before and just after it.
+   // The middle of that interval is paired with the pulse, if the interval is
+   // short enough to be meaningful. The two timestamps may come from
+   // different modules of the same clock, slightly out of order.
+   void AddWord(ISSWord *w) {
+       if (!w->HasExtendedTimestamp()) return;
+       UInt_t module = w->GetInfoModule();
+
+       // ADC timestamp: complete the pair of a pending EBIS pulse
+       if (id_v1495 != module) {
+           UInt_t id = GetClockID(module);
+           ULong64_t ticks = (CLOCK_V1730 == id) ? w->GetFullADC16Timestamp()
+                                                 : w->GetFullADCTimestamp();
+
+           if (!seen[module]) {
+               mod_epoch[module] = epoch[id];
+               if (clocks[id].IsAligned()) naligned++;
+           } else if (ticks < last_ticks[module]) {
+               if (mod_epoch[module] == epoch[id]) {
+                   // First module of the clock to be reset, so the old fit
+                   // does not apply any more until the next pair
+                   clocks[id].Restart();
+                   epoch[id]++;
+                   pending[id] = -1;
+                   clock_seen[id] = kFALSE;
+               } else if (clocks[id].IsAligned()) {
+                   naligned++;
+               }
+               mod_epoch[module] = epoch[id];
+           }
+           last_ticks[module] = ticks;
+           seen[module] = kTRUE;
+
+           // Modules not reset yet still count on the old clock
+           if (mod_epoch[module] != epoch[id]) return;
+           if (pending[id] >= 0) {
+               ULong64_t lo = (ticks < before[id]) ? ticks : before[id];
+               ULong64_t hi = (ticks < before[id]) ? before[id] : ticks;
+               Bool_t was_aligned = clocks[id].IsAligned();
+               if ((Double_t)(hi - lo) * clocks[id].GetTick() <= max_interval)
+                   clocks[id].AddPair(lo + (hi - lo) / 2, pending[id]);
+               if (!was_aligned && clocks[id].IsAligned()) naligned++;
+           }
+           pending[id] = -1;
+           clock_ticks[id] = ticks;
+           clock_seen[id] = kTRUE;
+           return;
+       }
+
+       // EBIS pulse: wait for the next timestamp of each clock
+       Double_t t = (Double_t)w->GetFullGlobalTimestamp() * global_tick;
+       for (UInt_t i = 0; i < NCLOCKS; i++) {
+           if (!clock_seen[i]) continue;
+           pending[i] = t;
+           before[i] = clock_ticks[i];
+       }
+       pulse[npulses % ISS_ALIGN_NPULSES] = (ULong64_t)(t + 0.5);
+       npulses++;
+   };
+
+   //..........................................................................
+   // Get the latest full ADC timestamp (ticks) of a module
+   inline ULong64_t GetLastTicks(UInt_t module) {
+       return((module < ISS_ALIGN_MAXMOD) ? last_ticks[module] : 0);
+   };
+
+   //..........................................................................
+   // Can the timestamps of a module be put on the common timeline yet?
+   inline Bool_t IsAligned(UInt_t module) {
+       if (module >= ISS_ALIGN_MAXMOD) return(kFALSE);
+       UInt_t id = GetClockID(module);
+       return(clocks[id].IsAligned() && seen[module] && mod_epoch[module] == epoch[id]);
+   };
+
+   //..........................................................................
+   // Get the number of times a clock or module became aligned. Hits held
+   // back until IsAligned() only need to be looked at again when it changes.
+   inline ULong64_t GetNAligned() {
+       return(naligned);
+   };
+
+   //..........................................................................
+   // Get the time in ns of the given ADC ticks from a module, or ISS_NOTIME
+   // if it is not aligned (yet)
+   inline ULong64_t GetTime(UInt_t module, ULong64_t ticks) {
+       if (!IsAligned(module)) return(ISS_NOTIME);
+       return(clocks[GetClockID(module)].GetTime(ticks));
+   };
+
+   //..........................................................................
+   // Get the index of the latest EBIS pulse at or before time t (ns), or -1
+   // if it is older than the pulses kept or not aligned. Hits arrive close to
+   // the newest pulse, so this normally looks at one or two entries.
+   Long64_t GetPulse(ULong64_t t) {
+       if (ISS_NOTIME == t) return(-1);
+       Long64_t oldest = npulses - ISS_ALIGN_NPULSES;
+       if (oldest < 0) oldest = 0;
+       for (Long64_t i = npulses - 1; i >= oldest; i--)
+           if (pulse[i % ISS_ALIGN_NPULSES] <= t) return(i);
+       return(-1);
+   };
+
+   //..........................................................................
+   // Get the time in ns of an EBIS pulse, or 0 if it is no longer kept
+   inline ULong64_t GetPulseTime(Long64_t i) {
+       if (i < 0 || i >= npulses || i < npulses - ISS_ALIGN_NPULSES) return(0);
+       return(pulse[i % ISS_ALIGN_NPULSES]);
+   };
+
+   //..........................................................................
+   // Get number of EBIS pulses
+   inline Long64_t GetNPulses() {
+       return(npulses);
+   };
+
+   //..........................................................................
+   // Get a clock
+   inline ISSClock *GetClock(UInt_t id) {
+       if (id >= NCLOCKS) return(NULL);
+       return(&clocks[id]);
+   };
+
+   //..........................................................................
+   // Show some information for debugging
+   void Show(UInt_t level = 1) {
+       if (level < 1) return;
+       printf("EBIS pulses: %lld\n", npulses);
+       printf("V1725 clock: ");
+       clocks[CLOCK_V1725].Show(level);
+       printf("V1730 clock: ");
+       clocks[CLOCK_V1730].Show(level);
+   };
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef __ISS_CHECKPOINT_HH__
+#define __ISS_CHECKPOINT_HH__
+
+#include <Rtypes.h> // For root types
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <unistd.h>
+
+#define ISS_CHECKPOINT_MAGIC   0x4B435353494E41ULL // "ANISSCK"
+#define ISS_CHECKPOINT_VERSION 1
+
+// Checkpoint file for long sorts. The state is serialised into memory with
+// Put() between Begin() and Commit(), and Commit() writes it to disk in a
+// background thread, so the decoding only pays for the copy. The file is
+// first written as <name>.tmp, synced to disk and then renamed, so a crash
+// while writing leaves the previous checkpoint intact. Load() reads it back for Get().
+//
+// Put() and Get() copy raw bytes, so they are only meant for plain types
+// and classes without pointers (e.g. ISSWord, ISSAlign), read back by the
+// same build of the same program.
+class ISSCheckpoint {
+
+ private:
+   std::string filename;
+   std::vector <char> buffer;  // State being built or read
+   std::thread writer;         // Thread writing the last committed state
+   size_t pos;                 // Read position in buffer
+   Bool_t ok;                  // Result of the last write
+
+   // enumeration for errors
+   enum err_t {
+       ERR_OPEN = -1,        // Unable to open checkpoint file
+       ERR_BAD_FILE = -2,    // Not a checkpoint file or wrong version
+       ERR_SHORT = -3        // Read past the end of the checkpoint
+   };
+
+   //..........................................................................
+   // Write a buffer to the checkpoint file (runs in the writer thread)
+   static void Write(std::string _filename, std::vector <char> _buffer, Bool_t *_ok) {
+       std::string tmp = _filename + ".tmp";
+       FILE *fp = fopen(tmp.c_str(), "wb");
+       if (!fp) {
+           fprintf(stderr, "Unable to open checkpoint %s - %m\n", tmp.c_str());
+           *_ok = kFALSE;
+           return;
+       }
+       *_ok = (fwrite(_buffer.data(), 1, _buffer.size(), fp) == _buffer.size());
+       // Make sure the data is on disk before the rename can be
+       if (fflush(fp) || fsync(fileno(fp))) *_ok = kFALSE;
+       if (fclose(fp)) *_ok = kFALSE;
+       if (*_ok && rename(tmp.c_str(), _filename.c_str())) *_ok = kFALSE;
+       if (!*_ok) fprintf(stderr, "Unable to write checkpoint %s\n", _filename.c_str());
+   };
+
+ public:
+
+   //..........................................................................
+   // Constructor
+   ISSCheckpoint(const Char_t *_filename = "checkpoint.dat") {
+       filename = _filename;
+       pos = 0;
+       ok = kTRUE;
+   };
+
+   //..........................................................................
+   // Destructor
+   ~ISSCheckpoint() {
+       Wait();
+   };
+
+   //..........................................................................
+   // Wait for the last checkpoint to be written. Returns kFALSE if it failed
+   Bool_t Wait() {
+       if (writer.joinable()) writer.join();
+       return(ok);
+   };
+
+   //..........................................................................
+   // Start a new checkpoint
+   void Begin() {
+       buffer.clear();
+       ULong64_t magic = ISS_CHECKPOINT_MAGIC;
+       UInt_t version = ISS_CHECKPOINT_VERSION;
+       Put(&magic, sizeof(magic));
+       Put(&version, sizeof(version));
+   };
+
+   //..........................................................................
+   // Add raw data to the checkpoint
+   void Put(const void *_data, size_t _size) {
+       const char *p = (const char *)_data;
+       buffer.insert(buffer.end(), p, p + _size);
+   };
+
+   //..........................................................................
+   // Add a single value to the checkpoint
+   template <typename T> void Put(const T &_value) {
+       Put(&_value, sizeof(T));
+   };
+
+   //..........................................................................
+   // Write the checkpoint in the background. The previous write, if still
+   // running, is waited for first
+   void Commit() {
+       Wait();
+       writer = std::thread(Write, filename, std::move(buffer), &ok);
+       buffer.clear();
+   };
+
+   //..........................................................................
+   // Read the checkpoint file. Returns kFALSE if there is none
+   Bool_t Load() {
+       Wait();
+       buffer.clear();
+       pos = 0;
+       FILE *fp = fopen(filename.c_str(), "rb");
+       if (!fp) return(kFALSE);
+       long size = -1;
+       if (!fseek(fp, 0, SEEK_END)) size = ftell(fp);
+       if (size < 0 || fseek(fp, 0, SEEK_SET)) {
+           fprintf(stderr, "Unable to read checkpoint %s - %m\n", filename.c_str());
+           fclose(fp);
+           throw(ERR_OPEN);
+       }
+       if ((size_t)size < sizeof(ULong64_t) + sizeof(UInt_t)) {
+           fprintf(stderr, "Checkpoint %s is too short\n", filename.c_str());
+           fclose(fp);
+           throw(ERR_BAD_FILE);
+       }
+       buffer.resize(size);
+       size_t n = fread(buffer.data(), 1, buffer.size(), fp);
+       fclose(fp);
+       if (n != buffer.size()) {
+           fprintf(stderr, "Unable to read checkpoint %s\n", filename.c_str());
+           throw(ERR_OPEN);
+       }
+
+       ULong64_t magic = 0;
+       UInt_t version = 0;
+       Get(&magic, sizeof(magic));
+       Get(&version, sizeof(version));
+       if (magic != ISS_CHECKPOINT_MAGIC || version != ISS_CHECKPOINT_VERSION) {
+           fprintf(stderr, "File %s is not a valid checkpoint\n", filename.c_str());
+           throw(ERR_BAD_FILE);
+       }
+       return(kTRUE);
+   };
+
+   //..........................................................................
+   // Read raw data from the loaded checkpoint
+   void Get(void *_data, size_t _size) {
+       if (pos + _size > buffer.size()) {
+           fprintf(stderr, "Checkpoint %s is truncated\n", filename.c_str());
+           throw(ERR_SHORT);
+       }
+       memcpy(_data, buffer.data() + pos, _size);
+       pos += _size;
+   };
+
+   //..........................................................................
+   // Read a single value from the loaded checkpoint
+   template <typename T> void Get(T &_value) {
+       Get(&_value, sizeof(T));
+   };
+
+   //..........................................................................
+   // Get the checkpoint file name
+   inline const Char_t *GetFileName() {
+       return(filename.c_str());
+   };
+
+   //..........................................................................
+   // Get the size of the state being built or read in bytes
+   inline size_t GetSize() {
+       return(buffer.size());
+   };
+};
+
+#endif
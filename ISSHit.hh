@@ -4,10 +4,15 @@
 #include <Rtypes.h> // For root types
 #include <vector>
 
+#define ISS_NOTIME 0xFFFFFFFFFFFFFFFFULL // Aligned timestamp of a hit which is not aligned
+
 class ISSHit {
 
 private:
     ULong64_t ts; // Full 48-bit timestamp from the CAEN ADC
+    ULong64_t aligned_ts; // Timestamp on the common V1495 timeline in ns (ISS_NOTIME if not aligned)
+    Long64_t ebis; // Index of the EBIS pulse the hit belongs to (-1 if none)
+    ULong64_t ebis_ts; // Aligned timestamp of that EBIS pulse in ns
     UInt_t  conversion; // ADC conversion
     Short_t module;  // ADC Module number
     Short_t channel; // ADC Channel number
@@ -35,9 +40,20 @@ public:
         ts = _ts;
         conversion = _conversion;
         data_id = _data_id;
+        aligned_ts = ISS_NOTIME;
+        ebis = -1;
+        ebis_ts = 0;
         trace.clear();
     }
 
+    //..........................................................................
+    // Set the aligned timestamp and the EBIS pulse (both in ns)
+    void SetAligned(ULong64_t _aligned_ts, Long64_t _ebis = -1, ULong64_t _ebis_ts = 0) {
+        aligned_ts = _aligned_ts;
+        ebis = _ebis;
+        ebis_ts = _ebis_ts;
+    }
+
     //..........................................................................
     // Add a sample to the trace
     void AddSample(UShort_t _word) {
@@ -62,6 +78,30 @@ public:
         return(ts);
     };
 
+    //..........................................................................
+    // Get aligned timestamp in ns
+    inline ULong64_t GetAlignedTimestamp() {
+        return(aligned_ts);
+    };
+
+    //..........................................................................
+    // Has the hit been put on the common timeline?
+    inline Bool_t IsAligned() {
+        return(aligned_ts != ISS_NOTIME);
+    };
+
+    //..........................................................................
+    // Get EBIS pulse index
+    inline Long64_t GetEBIS() {
+        return(ebis);
+    };
+
+    //..........................................................................
+    // Get aligned timestamp of the EBIS pulse in ns
+    inline ULong64_t GetEBISTimestamp() {
+        return(ebis_ts);
+    };
+
     //..........................................................................
     // Get conversion
     inline UInt_t GetConversion() {
@@ -99,6 +139,13 @@ public:
         return(ts < rhs.ts);
     };
 
+    //..........................................................................
+    // Comparison function for sorting by aligned timestamp, needed when hits
+    // from ADCs with different clocks are mixed
+    static bool CompareAligned(const ISSHit &lhs, const ISSHit &rhs) {
+        return(lhs.aligned_ts < rhs.aligned_ts);
+    };
+
     //..........................................................................
     // Show some information for debugging
     void Show(UInt_t level = 1) {
@@ -0,0 +1,214 @@
+#ifndef __ISS_RATE_HH__
+#define __ISS_RATE_HH__
+
+#include <Rtypes.h> // For root types
+#include <TTree.h>
+#include <cstdio>
+#include <cstring>
+
+#define ISS_RATE_MAXID 128  // Number of channel IDs (32*module + channel)
+#define ISS_RATE_NBINS 64   // Number of time bins kept in the ring buffer
+#define ISS_RATE_MAXMOD 64  // Number of module numbers for timestamp gaps
+#define ISS_RATE_NLATE 1000 // Late hits in a row after which the ring restarts
+
+// One time bin of the rate time series
+typedef struct s_rate_bin {
+    Long64_t  bin;                     // Bin number (-1 if unused)
+    UInt_t    counts[ISS_RATE_MAXID];  // Hits per channel
+    UInt_t    pileup[ISS_RATE_MAXID];  // Hits too close to the previous one
+    UInt_t    ngaps;                   // Gaps in the extended timestamps
+    ULong64_t gap_ns;                  // Total length of the gaps in ns
+} RATE_BIN;
+
+// Streaming per-channel rate, pile-up and timestamp gap counter with fixed
+// memory. Hits are counted in a ring of ISS_RATE_NBINS bins. A bin is either
+// a fixed slice of time (bin = t / width) or anything else the caller passes
+// explicitly, e.g. the EBIS pulse index. When a bin falls out of the ring it
+// is written to the attached tree, if any. Hits for bins already written out
+// are counted as late. If ISS_RATE_NLATE of them come in a row, the time has
+// jumped backwards (e.g. a timestamp reset), so the ring is written out and
+// restarted at the new bin. An instance is filled from one thread only.
+class ISSRate {
+
+ private:
+   ULong64_t width;          // Bin width in ns
+   ULong64_t pileup_window;  // Hits on one channel closer than this are pile-up (ns)
+   ULong64_t gap_threshold;  // Extended timestamps further apart than this are a gap (ns)
+
+   RATE_BIN ring[ISS_RATE_NBINS];
+   Long64_t head;            // Newest bin number in the ring (-1 if empty)
+
+   ULong64_t last_hit[ISS_RATE_MAXID];  // Time of the last hit per channel
+   ULong64_t last_ts[ISS_RATE_MAXMOD];  // Time of the last timestamp per module
+
+   ULong64_t total[ISS_RATE_MAXID];     // Total hits per channel
+   ULong64_t total_pileup[ISS_RATE_MAXID];
+   ULong64_t total_gaps, total_gap_ns;
+   ULong64_t nlate;          // Hits for bins which had already been written
+   ULong64_t nlate_row;      // Late hits since the last one in time
+   ULong64_t nrestart;       // Restarts of the ring after a backwards jump
+
+   TTree *tree;              //! Output tree for completed bins
+   RATE_BIN out;             // Branch buffer of the output tree
+
+   //..........................................................................
+   // Write a bin to the tree and clear it
+   void Flush(RATE_BIN *b) {
+       if (b->bin < 0) return;
+       if (tree) {
+           memcpy(&out, b, sizeof(RATE_BIN));
+           tree->Fill();
+       }
+       memset(b, 0, sizeof(RATE_BIN));
+       b->bin = -1;
+   };
+
+   //..........................................................................
+   // Get the ring entry of a bin, advancing the ring if needed. Returns NULL
+   // if the bin has already been written out.
+   RATE_BIN *GetBin(Long64_t bin) {
+       if (head >= 0 && bin <= head - ISS_RATE_NBINS) {
+           if (++nlate_row < ISS_RATE_NLATE) {
+               nlate++;
+               return(NULL);
+           }
+           // Too many in a row, so start again from this bin
+           Finish();
+           nrestart++;
+       }
+       nlate_row = 0;
+       // Write out the bins that drop off the ring, oldest first
+       if (bin > head) {
+           if (head >= 0) {
+               Long64_t first = head - ISS_RATE_NBINS + 1;
+               Long64_t last = bin - ISS_RATE_NBINS;
+               if (first < 0) first = 0;
+               if (last > head) last = head;
+               for (Long64_t i = first; i <= last; i++)
+                   Flush(&ring[i % ISS_RATE_NBINS]);
+           }
+           head = bin;
+       }
+       RATE_BIN *b = &ring[bin % ISS_RATE_NBINS];
+       if (b->bin != bin) {
+           Flush(b);
+           b->bin = bin;
+       }
+       return(b);
+   };
+
+ public:
+
+   //..........................................................................
+   // Constructor
+   ISSRate(ULong64_t _width = 1000000000, ULong64_t _pileup_window = 1000,
+           ULong64_t _gap_threshold = 10000000) {
+       width = _width;
+       pileup_window = _pileup_window;
+       gap_threshold = _gap_threshold;
+       tree = NULL;
+       Reset();
+   };
+
+   //..........................................................................
+   // Clear all counters (does not write anything)
+   void Reset() {
+       memset(ring, 0, sizeof(ring));
+       for (UInt_t i = 0; i < ISS_RATE_NBINS; i++) ring[i].bin = -1;
+       head = -1;
+       memset(last_hit, 0, sizeof(last_hit));
+       memset(last_ts, 0, sizeof(last_ts));
+       memset(total, 0, sizeof(total));
+       memset(total_pileup, 0, sizeof(total_pileup));
+       total_gaps = total_gap_ns = 0;
+       nlate = nlate_row = nrestart = 0;
+   };
+
+   //..........................................................................
+   // Attach an output tree, to which completed bins are written
+   void SetTree(TTree *_tree) {
+       tree = _tree;
+       if (!tree) return;
+       tree->Branch("bin",    &out.bin,   "bin/L");
+       tree->Branch("counts", out.counts, Form("counts[%d]/i", ISS_RATE_MAXID));
+       tree->Branch("pileup", out.pileup, Form("pileup[%d]/i", ISS_RATE_MAXID));
+       tree->Branch("ngaps",  &out.ngaps,  "ngaps/i");
+       tree->Branch("gap_ns", &out.gap_ns, "gap_ns/l");
+   };
+
+   //..........................................................................
+   // Add a hit on channel id at time t (ns). If bin is negative, the time
+   // bin t / width is used.
+   void AddHit(UInt_t id, ULong64_t t, Long64_t bin = -1) {
+       if (id >= ISS_RATE_MAXID) return;
+       if (bin < 0) bin = t / width;
+       Bool_t pu = (last_hit[id] && t >= last_hit[id] &&
+                    t - last_hit[id] < pileup_window);
+       last_hit[id] = t;
+       total[id]++;
+       if (pu) total_pileup[id]++;
+       RATE_BIN *b = GetBin(bin);
+       if (!b) return;
+       b->counts[id]++;
+       if (pu) b->pileup[id]++;
+   };
+
+   //..........................................................................
+   // Add an extended timestamp of a module at time t (ns) to look for gaps
+   void AddTimestamp(UInt_t module, ULong64_t t, Long64_t bin = -1) {
+       if (module >= ISS_RATE_MAXMOD) return;
+       ULong64_t prev = last_ts[module];
+       last_ts[module] = t;
+       if (!prev || t <= prev || t - prev < gap_threshold) return;
+       AddGap(t, t - prev, bin);
+   };
+
+   //..........................................................................
+   // Add a gap of length ns in the timestamps, ending at time t (ns), when
+   // the gaps are found elsewhere
+   void AddGap(ULong64_t t, ULong64_t length, Long64_t bin = -1) {
+       if (bin < 0) bin = t / width;
+       total_gaps++;
+       total_gap_ns += length;
+       RATE_BIN *b = GetBin(bin);
+       if (!b) return;
+       b->ngaps++;
+       b->gap_ns += length;
+   };
+
+   //..........................................................................
+   // Write out all bins still in the ring
+   void Finish() {
+       if (head < 0) return;
+       for (Long64_t i = head - ISS_RATE_NBINS + 1; i <= head; i++)
+           if (i >= 0) Flush(&ring[i % ISS_RATE_NBINS]);
+       head = -1;
+   };
+
+   //..........................................................................
+   // Getters
+   inline ULong64_t GetWidth()           { return(width); };
+   inline ULong64_t GetTotal(UInt_t id)  { return((id < ISS_RATE_MAXID) ? total[id] : 0); };
+   inline ULong64_t GetPileup(UInt_t id) { return((id < ISS_RATE_MAXID) ? total_pileup[id] : 0); };
+   inline ULong64_t GetGapThreshold()    { return(gap_threshold); };
+   inline ULong64_t GetNGaps()           { return(total_gaps); };
+   inline ULong64_t GetGapTime()         { return(total_gap_ns); };
+   inline ULong64_t GetNLate()           { return(nlate); };
+   inline ULong64_t GetNRestart()        { return(nrestart); };
+
+   //..........................................................................
+   // Show some information for debugging
+   void Show(UInt_t level = 1) {
+       if (level < 1) return;
+       printf("Timestamp gaps: %llu (%.3f s), late hits: %llu, restarts: %llu\n",
+              total_gaps, total_gap_ns * 1e-9, nlate, nrestart);
+       if (level < 2) return;
+       printf("ID     Total        Pile-up\n");
+       for (UInt_t i = 0; i < ISS_RATE_MAXID; i++) {
+           if (!total[i]) continue;
+           printf("%-5d %-12llu %-12llu\n", i, total[i], total_pileup[i]);
+       }
+   };
+};
+
+#endif
@@ -10,9 +10,12 @@ class ISSWord {
     ULong64_t word;
     ULong64_t last_global_ts;
     ULong64_t last_adc_ts;
+    ULong64_t last_adc16_ts;
     UInt_t ext_global_ts; // Global timestamp from logic unit CAEN V1495  (10 ns resolution)
     UInt_t ext_adc_ts;    // ADC timestamp from ADC unit :    CAEN V1725  ( 8 ns resolution) 
     UInt_t ext_adc16_ts;  //                                    or V1730  (16 ns resolution)
+    UShort_t global_mod_id; // Module numbers of the V1495 and the V1730
+    UShort_t adc16_mod_id;
 
  public:
     
@@ -22,6 +25,11 @@ class ISSWord {
         ext_global_ts = 0;
         ext_adc_ts    = 0;
         ext_adc16_ts  = 0;
+        last_global_ts = 0;
+        last_adc_ts    = 0;
+        last_adc16_ts  = 0;
+        global_mod_id  = CAEN_V1495_MOD_ID;
+        adc16_mod_id   = CAEN_V1730_MOD_ID;
         Set(_word);
     };
 
@@ -32,14 +40,21 @@ class ISSWord {
         if (HasExtendedTimestamp()) {
             UShort_t mod_id = GetInfoModule();
             // don't mix up ADC and logic unit timestamps!
-            if (CAEN_V1495_MOD_ID == mod_id) ext_global_ts = GetInfoField(); 
-            // NOTE: currently not used anywhere!
-            else if (CAEN_V1730_MOD_ID == mod_id) ext_adc16_ts = GetInfoField(); 
+            if (global_mod_id == mod_id) ext_global_ts = GetInfoField(); 
+            else if (adc16_mod_id == mod_id) ext_adc16_ts = GetInfoField(); 
             else ext_adc_ts = GetInfoField();
                
         }
     };
 
+    //..........................................................................
+    // Set the module numbers of the V1495 and the V1730, if they are not the
+    // default ones
+    void SetModuleIDs(UShort_t _global_mod_id, UShort_t _adc16_mod_id) {
+        global_mod_id = _global_mod_id;
+        adc16_mod_id = _adc16_mod_id;
+    };
+
     //..........................................................................
     // Get the word
     inline ULong64_t GetWord() {
@@ -147,6 +162,17 @@ class ISSWord {
         return(ts);
     };
 
+    //..........................................................................
+    // Get the full V1730 ADC 48-bit timestamp 
+    inline ULong64_t GetFullADC16Timestamp() {
+        if (IsTrace()) return(last_adc16_ts);
+        ULong64_t ts = (ULong64_t)ext_adc16_ts;
+        ts <<= 28;
+        ts |= (word & 0xFFFFFFF);
+        last_adc16_ts = ts;
+        return(ts);
+    };
+
 
     //..........................................................................
     // Get field from an information word (full timestamp)
@@ -234,7 +260,7 @@ class ISSWord {
         UInt_t key = GetItemCode();
         UInt_t code = GetInfoCode();
         if (level < 1) return;
-        if ( IsInfo() && CAEN_V1495_MOD_ID == GetInfoModule()) {
+        if ( IsInfo() && global_mod_id == GetInfoModule()) {
         	printf("Word: 0x%016llX GlobalTimestamp: 0x%012llX Type: %-6s \t",
             			     word, GetFullGlobalTimestamp(), keys[key]);
         } else {
@@ -0,0 +1,727 @@
+// Sorter for ISS data files without the ROOT interpreter.
+//
+// Decodes the files of a run list, orders the hits on the aligned V1495
+// timeline, builds events and writes a tree and histograms. The three stages
+// (decode -> order/build -> output) run in their own threads and pass hits
+// in batches, unless Pipeline is 0 in the configuration.
+//
+// Usage: iss_sort [-c config] runlist
+//
+// The run list has one data file per line, '#' starts a comment. The
+// configuration is read with TEnv, see examples/iss_sort.conf.
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <iterator>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+#include <TROOT.h>
+#include <TFile.h>
+#include <TTree.h>
+#include <TH1I.h>
+#include <TH1F.h>
+#include <TDirectory.h>
+#include <TEnv.h>
+#include <TString.h>
+
+#include "ISSBuffer.hh"
+#include "ISSFile.hh"
+#include "ISSWord.hh"
+#include "ISSHit.hh"
+#include "ISSAlign.hh"
+#include "ISSRate.hh"
+
+#define MAXID 1024     // Number of channel IDs (32*module + channel)
+#define BATCHSIZE 65536 // Number of hits passed between stages at a time
+#define QUEUESIZE 16    // Number of batches waiting between two stages
+
+// Tree entry definition, the same as in examples/make_tree_onlyadcstamps.C
+struct struct_tree_entry {
+    unsigned long long global_event_ts; //full V1495 48-bit timestamp of the EBIS pulse (in V1495 ticks)
+    unsigned long long adc_ts; //full 48-bit timestamp from the ADC module
+    unsigned int       module; // module number
+    unsigned int       channel; // channel number
+    unsigned short     data_id; // QLong = 0, QShort = 1, FineTiming = 3
+    unsigned int       adc_data; // ADC conversion
+};
+
+// Aligned time of the same entry
+struct struct_align_entry {
+    unsigned long long aligned_ts; // V1725/V1730 timestamp on the V1495 timeline (ns)
+    long long          ebis; // Index of the EBIS pulse of the hit (-1 if none)
+    unsigned long long ebis_ts; // Time of that EBIS pulse on the same timeline (ns)
+};
+
+// Gap in the extended timestamps of a module
+struct gap_t {
+    ULong64_t t;        // Aligned time of the timestamp after the gap (ns)
+    ULong64_t length;   // Length of the gap (ns)
+};
+
+// Hits passed between the stages, with the event number of each hit once
+// the events have been built, and the timestamp gaps found by the decoder
+struct batch_t {
+    std::vector <ISSHit> hits;
+    std::vector <Long64_t> event;
+    std::vector <gap_t> gaps;
+};
+
+//-----------------------------------------------------------------------------
+// Settings from the configuration file
+struct config_t {
+    TString outfile;          // Output ROOT file
+    Bool_t write_tree;        // Write the hit tree
+    Bool_t write_rates;       // Write the rate time series
+    Bool_t pipeline;          // Run the stages in their own threads
+    UInt_t max_hits;          // Maximum number of hits in the reorder buffer
+    ULong64_t reorder_window; // Hits older than the newest by this are in order (ns)
+    ULong64_t event_width;    // Event width (ns)
+    ULong64_t ebis_window;    // On-beam window after each EBIS pulse (ns)
+    ULong64_t rate_width;     // Bin width of the rate time series (ns)
+    ULong64_t gap_threshold;  // Extended timestamps further apart are a gap (ns)
+    Int_t id_ebis;            // Module number of the V1495 logic unit
+    Int_t id_v1730;           // Module number of the V1730
+    Double_t tick_v1495;      // Tick lengths in ns
+    Double_t tick_v1725;
+    Double_t tick_v1730;
+    Bool_t only_mapped;       // Only keep channels in the channel map
+    TString name[MAXID];      // Channel map (empty if not mapped)
+} cfg;
+
+//-----------------------------------------------------------------------------
+// Read the configuration file
+Bool_t read_config(const Char_t *filename) {
+
+    TEnv env;
+    if (filename && env.ReadFile(filename, kEnvUser) != 0) {
+        fprintf(stderr, "Unable to read configuration %s\n", filename);
+        return(kFALSE);
+    }
+
+    cfg.outfile        = env.GetValue("Output.File", "iss_sort.root");
+    cfg.write_tree     = env.GetValue("Output.Tree", kTRUE);
+    cfg.write_rates    = env.GetValue("Output.Rates", kTRUE);
+    cfg.pipeline       = env.GetValue("Pipeline", kTRUE);
+    cfg.max_hits       = env.GetValue("MaxHits", 1000000);
+    cfg.reorder_window = (ULong64_t)env.GetValue("Window.Reorder", 1.0e6);
+    cfg.event_width    = (ULong64_t)env.GetValue("Window.Event", 1.0e4);
+    cfg.ebis_window    = (ULong64_t)env.GetValue("Window.EBIS", 0.0);
+    cfg.rate_width     = (ULong64_t)env.GetValue("Rate.BinWidth", 1.0e9);
+    cfg.gap_threshold  = (ULong64_t)env.GetValue("Rate.GapThreshold", 1.0e7);
+    cfg.id_ebis        = env.GetValue("Module.EBIS", CAEN_V1495_MOD_ID);
+    cfg.id_v1730       = env.GetValue("Module.V1730", CAEN_V1730_MOD_ID);
+    cfg.tick_v1495     = env.GetValue("Tick.V1495", 10.0);
+    cfg.tick_v1725     = env.GetValue("Tick.V1725", 8.0);
+    cfg.tick_v1730     = env.GetValue("Tick.V1730", 16.0);
+    cfg.only_mapped    = env.GetValue("Channel.OnlyMapped", kFALSE);
+
+    // Info words have 6 bits for the module number, ADC words only 5
+    if (cfg.id_ebis < 0 || cfg.id_ebis > 63 || cfg.id_v1730 < 0 || cfg.id_v1730 > 31 ||
+        cfg.id_ebis == cfg.id_v1730) {
+        fprintf(stderr, "Module.EBIS must be 0-63 and Module.V1730 0-31, and not the same\n");
+        return(kFALSE);
+    }
+    if (cfg.tick_v1495 <= 0 || cfg.tick_v1725 <= 0 || cfg.tick_v1730 <= 0) {
+        fprintf(stderr, "The Tick values must be positive\n");
+        return(kFALSE);
+    }
+    if (cfg.max_hits < 2) cfg.max_hits = 2;
+    if (!cfg.rate_width) cfg.rate_width = 1000000000;
+
+    // Channel map: Channel.<id>: <name>
+    for (UInt_t i = 0; i < MAXID; i++)
+        cfg.name[i] = env.GetValue(Form("Channel.%u", i), "");
+
+    return(kTRUE);
+}
+
+//-----------------------------------------------------------------------------
+// Read the run list
+Bool_t read_runlist(const Char_t *filename, std::vector <std::string> &files) {
+
+    TString s;
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        fprintf(stderr, "Unable to open run list %s - %m\n", filename);
+        return(kFALSE);
+    }
+    while (s.Gets(fp)) {
+        Ssiz_t hash = s.First('#');
+        if (hash != kNPOS) s.Remove(hash);
+        s = s.Strip(TString::kBoth);
+        if (s.Length()) files.push_back(s.Data());
+    }
+    fclose(fp);
+    return(kTRUE);
+}
+
+//-----------------------------------------------------------------------------
+// Bounded queue of batches between two stages
+class BatchQueue {
+
+ private:
+   std::deque <batch_t> queue;
+   std::mutex mutex;
+   std::condition_variable not_empty, not_full;
+   Bool_t closed;
+
+ public:
+   BatchQueue() {
+       closed = kFALSE;
+   };
+
+   //..........................................................................
+   // Add a batch, waiting while the queue is full
+   void Push(batch_t &b) {
+       std::unique_lock <std::mutex> lock(mutex);
+       not_full.wait(lock, [this] { return(queue.size() < QUEUESIZE || closed); });
+       queue.push_back(std::move(b));
+       not_empty.notify_one();
+   };
+
+   //..........................................................................
+   // Take a batch, waiting while the queue is empty. Returns kFALSE when the
+   // queue is closed and empty
+   Bool_t Pop(batch_t &b) {
+       std::unique_lock <std::mutex> lock(mutex);
+       not_empty.wait(lock, [this] { return(!queue.empty() || closed); });
+       if (queue.empty()) return(kFALSE);
+       b = std::move(queue.front());
+       queue.pop_front();
+       not_full.notify_one();
+       return(kTRUE);
+   };
+
+   //..........................................................................
+   // No more batches will be added
+   void Close() {
+       std::lock_guard <std::mutex> lock(mutex);
+       closed = kTRUE;
+       not_empty.notify_all();
+       not_full.notify_all();
+   };
+};
+
+// Passes a batch on to the next stage
+typedef std::function <void(batch_t &)> sink_t;
+
+//-----------------------------------------------------------------------------
+// Decode stage: words -> hits with aligned timestamps
+class Decoder {
+
+ private:
+   sink_t sink;
+   batch_t batch;
+   ISSWord word;
+   ISSAlign align;
+   ULong64_t last_adc8_ts, last_adc16_ts, global_adc_ts;
+   Bool_t new_run;
+   std::vector <ISSHit> held;          // Hits waiting for their clock to be aligned
+   std::vector <ULong64_t> held_ticks; // and their raw ADC timestamps
+   ULong64_t naligned;                 // Alignment changes seen by the held hits
+   ULong64_t last_ts[ISS_RATE_MAXMOD]; // Aligned time of the last timestamp per module
+
+   //..........................................................................
+   // Look for a gap before an extended timestamp of a module at time t (ns)
+   void CheckGap(UInt_t module, ULong64_t t) {
+       if (module >= ISS_RATE_MAXMOD || ISS_NOTIME == t) return;
+       ULong64_t prev = last_ts[module];
+       last_ts[module] = t;
+       if (!prev || t <= prev || t - prev < cfg.gap_threshold) return;
+       gap_t g = { t, t - prev };
+       batch.gaps.push_back(g);
+   };
+
+   //..........................................................................
+   // Align the held hits whose clock has been aligned. With force, the rest
+   // are passed on as not aligned.
+   void Release(Bool_t force) {
+       size_t n = 0;
+       for (size_t i = 0; i < held.size(); i++) {
+           UInt_t module = held[i].GetModule();
+           if (!force && !align.IsAligned(module)) {
+               if (n != i) held[n] = std::move(held[i]);
+               held_ticks[n++] = held_ticks[i];
+               continue;
+           }
+           ULong64_t aligned_ts = align.GetTime(module, held_ticks[i]);
+           Long64_t ebis = align.GetPulse(aligned_ts);
+           if (ISS_NOTIME == aligned_ts) n_unaligned++;
+           held[i].SetAligned(aligned_ts, ebis, align.GetPulseTime(ebis));
+           batch.hits.push_back(std::move(held[i]));
+       }
+       held.resize(n);
+       held_ticks.resize(n);
+   };
+
+ public:
+   ULong64_t n_word, n_info, n_adc, n_adc_ts, n_global_ts, n_qlong, n_qshort,
+             n_finetime, n_blocks, n_unaligned;
+
+   Decoder(sink_t _sink) : align(cfg.tick_v1495, cfg.tick_v1725, cfg.tick_v1730) {
+       sink = _sink;
+       word.SetModuleIDs(cfg.id_ebis, cfg.id_v1730);
+       align.SetModuleIDs(cfg.id_ebis, cfg.id_v1730);
+       last_adc8_ts = last_adc16_ts = global_adc_ts = 0;
+       new_run = kFALSE;
+       naligned = 0;
+       memset(last_ts, 0, sizeof(last_ts));
+       n_word = n_info = n_adc = n_adc_ts = n_global_ts = n_qlong = n_qshort = 0;
+       n_finetime = n_blocks = n_unaligned = 0;
+   };
+
+   //..........................................................................
+   // Pass the hits decoded so far to the next stage. While hits are held
+   // back, nothing is passed on, so that they are not overtaken by later
+   // hits, unless there are too many of them or it is the final flush.
+   void Flush(Bool_t final = kFALSE) {
+       if (!held.empty()) {
+           if (!final && held.size() + batch.hits.size() < cfg.max_hits) return;
+           Release(kTRUE);
+       }
+       if (batch.hits.empty() && batch.gaps.empty()) return;
+       sink(batch);
+       batch.hits.clear();
+       batch.gaps.clear();
+       batch.hits.reserve(BATCHSIZE);
+   };
+
+   //..........................................................................
+   // Treat a single word
+   void TreatWord(ISSWord *w) {
+
+       n_word++;
+       align.AddWord(w);
+
+       // Held hits can only be released when some module has become aligned
+       if (align.GetNAligned() != naligned) {
+           naligned = align.GetNAligned();
+           if (!held.empty()) Release(kFALSE);
+       }
+
+       if (w->IsInfo()) {
+           n_info++;
+           if (!w->HasExtendedTimestamp()) return;
+           UInt_t module = w->GetInfoModule();
+           if ((Int_t)module == cfg.id_ebis) {
+               n_global_ts++;
+               return;
+           }
+           // The V1495 only has a timestamp for each EBIS pulse, so only
+           // the ADC modules are looked at for gaps
+           CheckGap(module, align.GetTime(module, align.GetLastTicks(module)));
+           if ((Int_t)module == cfg.id_v1730) {
+               last_adc16_ts = w->GetFullADC16Timestamp();
+               n_adc_ts++;
+           } else {
+               // The ADC timestamps restart if the DAQ was stopped between
+               // runs, so keep the raw V1725 timestamps increasing
+               ULong64_t ts = w->GetFullADCTimestamp();
+               if (new_run && last_adc8_ts && ts < last_adc8_ts)
+                   global_adc_ts += last_adc8_ts + 250000;
+               new_run = kFALSE;
+               last_adc8_ts = ts;
+               n_adc_ts++;
+           }
+           return;
+       }
+
+       if (!w->IsADC()) return;
+       n_adc++;
+       UInt_t module = w->GetADCModule();
+       UInt_t channel = w->GetADCChannel();
+       UInt_t id = 32 * module + channel;
+       if (w->IsQLong()) n_qlong++;
+       if (w->IsQShort()) n_qshort++;
+       if (w->IsFineTiming()) n_finetime++;
+       if (id >= MAXID) return; // No room for it in the spectra
+       if (cfg.only_mapped && !cfg.name[id].Length()) return;
+
+       Bool_t v1730 = ((Int_t)module == cfg.id_v1730);
+       ULong64_t adc_ts = v1730 ? last_adc16_ts : global_adc_ts + last_adc8_ts;
+       ULong64_t ticks = align.GetLastTicks(module);
+       ISSHit h(module, channel, adc_ts, w->GetADCConversion(), w->GetADCDataID());
+
+       // Hold the hit back until its clock is aligned
+       if (!align.IsAligned(module)) {
+           held.push_back(h);
+           held_ticks.push_back(ticks);
+           return;
+       }
+
+       ULong64_t aligned_ts = align.GetTime(module, ticks);
+       Long64_t ebis = align.GetPulse(aligned_ts);
+       h.SetAligned(aligned_ts, ebis, align.GetPulseTime(ebis));
+       batch.hits.push_back(h);
+       if (batch.hits.size() >= BATCHSIZE) Flush();
+   };
+
+   //..........................................................................
+   // Treat a single file
+   void TreatFile(const Char_t *filename) {
+
+       ISSBuffer b;
+
+       printf("Opening file: %s\n", filename);
+       ISSFile f(filename);
+       new_run = kTRUE;
+
+       for (UInt_t i = 0; i < f.GetNBlocks(); i++) {
+           b.Set(f.GetBlock(i));
+           for (UInt_t j = 0; j < b.GetNWords(); j++) {
+               word.Set(b.GetWord(j));
+               TreatWord(&word);
+           }
+           n_blocks++;
+       }
+       f.Close();
+   };
+
+   //..........................................................................
+   // Show the statistics
+   void Show() {
+       printf("Number  data words: %llu\n", n_word);
+       printf("Number  info words: %llu\n", n_info);
+       printf("Number   global ts: %llu\n", n_global_ts);
+       printf("Number      adc ts: %llu\n", n_adc_ts);
+       printf("Number   adc words: %llu\n", n_adc);
+       printf("Number   QL  words: %llu\n", n_qlong);
+       printf("Number   QS  words: %llu\n", n_qshort);
+       printf("Number   FT  words: %llu\n", n_finetime);
+       printf("Number of hits not aligned: %llu\n", n_unaligned);
+       align.Show();
+   };
+};
+
+//-----------------------------------------------------------------------------
+// Order and build stage: time orders the hits on the aligned timeline and
+// groups them into events
+class Orderer {
+
+ private:
+   sink_t sink;
+   std::vector <ISSHit> buffer; // Hits not yet passed on, in time order
+   ULong64_t newest;            // Newest aligned timestamp seen
+   ULong64_t event_start;       // Aligned timestamp of the first hit in the event
+   Long64_t event;              // Current event number
+   std::vector <gap_t> gaps;    // Timestamp gaps to pass on with the next hits
+
+   //..........................................................................
+   // Pass on the first n hits of the buffer with their event numbers
+   void Emit(size_t n) {
+       if (!n && gaps.empty()) return;
+       batch_t out;
+       out.gaps.swap(gaps);
+       out.hits.assign(std::make_move_iterator(buffer.begin()),
+                       std::make_move_iterator(buffer.begin() + n));
+       buffer.erase(buffer.begin(), buffer.begin() + n);
+       out.event.resize(n);
+       for (size_t i = 0; i < n; i++) {
+           ULong64_t t = out.hits[i].GetAlignedTimestamp();
+           if (event < 0 || t > event_start + cfg.event_width) {
+               event++;
+               event_start = t;
+           }
+           out.event[i] = event;
+       }
+       sink(out);
+   };
+
+ public:
+
+   Orderer(sink_t _sink) {
+       sink = _sink;
+       newest = 0;
+       event_start = 0;
+       event = -1;
+   };
+
+   //..........................................................................
+   // Add a batch of hits
+   void Add(batch_t &b) {
+
+       // The rate counter takes gaps slightly out of order, so they are just
+       // passed on with the next hits
+       gaps.insert(gaps.end(), b.gaps.begin(), b.gaps.end());
+
+       // Hits which could not be aligned have no place in time, so they are
+       // passed on at once, outside of any event
+       std::vector <ISSHit>::iterator end =
+           std::partition(b.hits.begin(), b.hits.end(),
+                          [](ISSHit &h) { return(h.IsAligned()); });
+       if (end != b.hits.end()) {
+           batch_t out;
+           out.hits.assign(std::make_move_iterator(end),
+                           std::make_move_iterator(b.hits.end()));
+           out.event.assign(out.hits.size(), -1);
+           b.hits.erase(end, b.hits.end());
+           sink(out);
+       }
+
+       // The batch is mostly in order already, so sort it and merge it in
+       std::sort(b.hits.begin(), b.hits.end(), ISSHit::CompareAligned);
+       size_t middle = buffer.size();
+       buffer.insert(buffer.end(), std::make_move_iterator(b.hits.begin()),
+                     std::make_move_iterator(b.hits.end()));
+       std::inplace_merge(buffer.begin(), buffer.begin() + middle, buffer.end(),
+                          ISSHit::CompareAligned);
+       if (buffer.empty()) return;
+       newest = std::max(newest, buffer.back().GetAlignedTimestamp());
+
+       // Hits older than the reorder window cannot be overtaken any more
+       size_t n = 0;
+       if (newest > cfg.reorder_window) {
+           ISSHit limit;
+           limit.SetAligned(newest - cfg.reorder_window);
+           n = std::upper_bound(buffer.begin(), buffer.end(), limit,
+                                ISSHit::CompareAligned) - buffer.begin();
+       }
+
+       // Never keep more than the maximum number of hits
+       if (buffer.size() - n > cfg.max_hits) n = buffer.size() - cfg.max_hits / 2;
+       Emit(n);
+   };
+
+   //..........................................................................
+   // Pass on all remaining hits
+   void Finish() {
+       Emit(buffer.size());
+   };
+};
+
+//-----------------------------------------------------------------------------
+// Output stage: tree and histograms. All ROOT objects are only used here
+class Writer {
+
+ private:
+   TTree *tree;
+   struct_tree_entry issentry;
+   struct_align_entry alignentry;
+   TH1I *hStats, *hstatQLong, *hstatQShort, *hHitsInEvent;
+   TH1F *hEBISdt;
+   TH1F *hQLong[MAXID], *hQShort[MAXID], *hQLongBeam[MAXID];
+   ISSRate *rate;
+   TTree *tRate;
+   TDirectory *dir;    // Output directory
+   Long64_t event;     // Current event number
+   Long64_t hit_event; // Event number of the hit (-1 if not aligned)
+   UInt_t event_hits;  // Hits in the current event
+
+   //..........................................................................
+   // Get a spectrum, creating it when first used. This happens in the
+   // writer thread, where gDirectory is not the output file, so the
+   // directory is set explicitly.
+   TH1F *Spectrum(TH1F **h, UInt_t id, const Char_t *prefix, const Char_t *title) {
+       if (!h[id]) {
+           TString name = cfg.name[id].Length() ? cfg.name[id] : TString(Form("%04u", id));
+           h[id] = new TH1F(Form("%s%s", prefix, name.Data()),
+                            Form("%s %s", title, name.Data()), 65536, 0, 65536);
+           h[id]->SetDirectory(dir);
+       }
+       return(h[id]);
+   };
+
+ public:
+   ULong64_t n_hits, n_events;
+
+   Writer(TDirectory *_dir) {
+       dir = _dir;
+       tree = NULL;
+       if (cfg.write_tree) {
+           tree = new TTree("isstree", "ISS data tree");
+           tree->Branch("issentry", &issentry, "global_event_ts/l:adc_ts/l:module/i:channel/i:data_id/i:adc_data/i");
+           tree->Branch("issalign", &alignentry, "aligned_ts/l:ebis/L:ebis_ts/l");
+           tree->Branch("event", &hit_event, "event/L");
+       }
+       hStats       = new TH1I("hStats",      "Total statistics",  MAXID, 0, MAXID);
+       hstatQLong   = new TH1I("hstatQLong",  "QLong statistics",  MAXID, 0, MAXID);
+       hstatQShort  = new TH1I("hstatQShort", "QShort statistics", MAXID, 0, MAXID);
+       hHitsInEvent = new TH1I("hHitsInEvent", "Hits in event", 1000, 0, 1000);
+       hEBISdt      = new TH1F("hEBISdt", "Time since EBIS pulse in us", 100000, 0, 100000);
+       for (UInt_t i = 0; i < MAXID; i++) hQLong[i] = hQShort[i] = hQLongBeam[i] = NULL;
+       rate = NULL;
+       tRate = NULL;
+       if (cfg.write_rates) {
+           tRate = new TTree("rates", "Rate per channel per time bin");
+           rate = new ISSRate(cfg.rate_width, 1000, cfg.gap_threshold);
+           rate->SetTree(tRate);
+       }
+       event = hit_event = -1;
+       event_hits = 0;
+       n_hits = n_events = 0;
+   };
+
+   ~Writer() {
+       delete rate;
+   };
+
+   //..........................................................................
+   // Add a batch of ordered hits
+   void Add(batch_t &b) {
+       if (rate)
+           for (size_t i = 0; i < b.gaps.size(); i++)
+               rate->AddGap(b.gaps[i].t, b.gaps[i].length);
+       for (size_t i = 0; i < b.hits.size(); i++) {
+           ISSHit *h = &b.hits[i];
+           UInt_t id = 32 * h->GetModule() + h->GetChannel();
+           ULong64_t t = h->GetAlignedTimestamp();
+           n_hits++;
+
+           hit_event = b.event[i];
+           if (hit_event >= 0 && hit_event != event) {
+               if (event >= 0) hHitsInEvent->Fill(event_hits);
+               event = hit_event;
+               event_hits = 0;
+               n_events++;
+           }
+           if (hit_event >= 0) event_hits++;
+
+           hStats->AddBinContent(id, 1);
+           if (h->GetEBIS() >= 0) hEBISdt->Fill((t - h->GetEBISTimestamp()) * 1e-3);
+           if (h->GetDataID() == 0) {
+               hstatQLong->AddBinContent(id, 1);
+               if (id < MAXID) {
+                   Spectrum(hQLong, id, "hQLong", "QLong spectrum")->Fill(h->GetConversion());
+                   if (cfg.ebis_window && h->GetEBIS() >= 0 &&
+                       t - h->GetEBISTimestamp() < cfg.ebis_window)
+                       Spectrum(hQLongBeam, id, "hQLongBeam", "QLong spectrum on beam")->Fill(h->GetConversion());
+               }
+               if (rate && h->IsAligned()) rate->AddHit(id, t);
+           }
+           if (h->GetDataID() == 1) {
+               hstatQShort->AddBinContent(id, 1);
+               if (id < MAXID) Spectrum(hQShort, id, "hQShort", "QShort spectrum")->Fill(h->GetConversion());
+           }
+
+           if (!tree) continue;
+           issentry.global_event_ts = (ULong64_t)(h->GetEBISTimestamp() / cfg.tick_v1495 + 0.5);
+           issentry.adc_ts = h->GetTimestamp();
+           issentry.module = h->GetModule();
+           issentry.channel = h->GetChannel();
+           issentry.data_id = h->GetDataID();
+           issentry.adc_data = h->GetConversion();
+           alignentry.aligned_ts = t;
+           alignentry.ebis = h->GetEBIS();
+           alignentry.ebis_ts = h->GetEBISTimestamp();
+           tree->Fill();
+       }
+   };
+
+   //..........................................................................
+   // Finish the last event and the rate time series
+   void Finish() {
+       if (event >= 0) hHitsInEvent->Fill(event_hits);
+       if (rate) rate->Finish();
+   };
+
+   //..........................................................................
+   // Show the statistics of the rate time series
+   void Show() {
+       if (rate) rate->Show();
+   };
+};
+
+//-----------------------------------------------------------------------------
+void usage() {
+    fprintf(stderr, "Usage: iss_sort [-c config] runlist\n");
+}
+
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv) {
+
+    const Char_t *config = NULL;
+    Int_t opt;
+    while ((opt = getopt(argc, argv, "c:h")) != -1) {
+        switch (opt) {
+         case 'c':
+            config = optarg;
+            break;
+         default:
+            usage();
+            return(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return(1);
+    }
+
+    std::vector <std::string> files;
+    if (!read_config(config)) return(1);
+    if (!read_runlist(argv[optind], files)) return(1);
+
+#if ROOT_VERSION_CODE >= ROOT_VERSION(6,0,0)
+    ROOT::EnableThreadSafety();
+#endif
+
+    TFile *f = TFile::Open(cfg.outfile, "recreate");
+    if (!f) return(1);
+
+    // Set up the stages, connected directly or through queues
+    Writer writer(f);
+    BatchQueue q_order, q_write;
+    Bool_t pipeline = cfg.pipeline;
+    Orderer orderer(pipeline ? sink_t([&](batch_t &b) { q_write.Push(b); })
+                             : sink_t([&](batch_t &b) { writer.Add(b); }));
+    Decoder decoder(pipeline ? sink_t([&](batch_t &b) { q_order.Push(b); })
+                             : sink_t([&](batch_t &b) { orderer.Add(b); }));
+
+    std::thread t_order, t_write;
+    if (pipeline) {
+        t_order = std::thread([&] {
+            batch_t b;
+            while (q_order.Pop(b)) orderer.Add(b);
+            orderer.Finish();
+            q_write.Close();
+        });
+        t_write = std::thread([&] {
+            batch_t b;
+            while (q_write.Pop(b)) writer.Add(b);
+        });
+    }
+
+    // Decode in this thread
+    Int_t status = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        try {
+            decoder.TreatFile(files[i].c_str());
+        } catch (...) {
+            fprintf(stderr, "Error while reading %s, skipping the rest of it\n",
+                    files[i].c_str());
+            status = 2;
+        }
+    }
+    decoder.Flush(kTRUE);
+
+    if (pipeline) {
+        q_order.Close();
+        t_order.join();
+        t_write.join();
+    } else {
+        orderer.Finish();
+    }
+    writer.Finish();
+
+    // Write statistics
+    printf("\n -------- \n");
+    printf("Number of blocks: %llu\n", decoder.n_blocks);
+    decoder.Show();
+    printf("Number of hits written: %llu\n", writer.n_hits);
+    printf("Number of events: %llu\n", writer.n_events);
+    writer.Show();
+
+    // Write everything
+    f->Write();
+    f->Close();
+
+    return(status);
+}